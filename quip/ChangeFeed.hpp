@@ -0,0 +1,130 @@
+#pragma once
+#include <make_exception.hpp>
+#include <sysarch.h>
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace quip {
+	/**
+	 * @struct	Change
+	 * @brief	Describes an entry that was added to or removed from a history directory.
+	 */
+	struct Change {
+		enum class Type : unsigned char {
+			Added,
+			Removed,
+		};
+
+		Type type;
+		/// @brief	The filename of the entry.
+		std::string name;
+	};
+
+	/**
+	 * @class	ChangeFeed
+	 * @brief	Reports entries that were added to or removed from a history directory since the last poll.
+	 *			Uses inotify where it is available; on other platforms poll() always requests a rescan.
+	 */
+	class ChangeFeed {
+		int _fd{ -1 };
+		/// @brief	Set when events were lost or the directory itself went away; the feed can't be trusted after this.
+		bool _broken{ false };
+
+	public:
+		/// @brief	Checks if change feeds are supported on this platform.
+		static constexpr bool is_supported()
+		{
+		#ifdef OS_LINUX
+			return true;
+		#else
+			return false;
+		#endif
+		}
+
+		/**
+		 * @brief			Starts watching the given directory for changes.
+		 * @param directory	The history directory to watch.  It must already exist.
+		 */
+		ChangeFeed(std::filesystem::path const& directory)
+		{
+		#ifdef OS_LINUX
+			if (_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); _fd == -1)
+				throw make_exception("Failed to initialize inotify!");
+			if (inotify_add_watch(_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR) == -1) {
+				close(_fd);
+				throw make_exception("Failed to watch directory '", directory, "' for changes!");
+			}
+		#else
+			(void)directory;
+		#endif
+		}
+		ChangeFeed(ChangeFeed const&) = delete;
+		ChangeFeed(ChangeFeed&& o) noexcept : _fd{ std::exchange(o._fd, -1) }, _broken{ o._broken } {}
+		ChangeFeed& operator=(ChangeFeed const&) = delete;
+		ChangeFeed& operator=(ChangeFeed&& o) noexcept
+		{
+			std::swap(_fd, o._fd);
+			std::swap(_broken, o._broken);
+			return *this;
+		}
+		~ChangeFeed()
+		{
+		#ifdef OS_LINUX
+			if (_fd != -1)
+				close(_fd);
+		#endif
+		}
+
+		/**
+		 * @brief		Gets the changes that occurred since the last poll, without blocking.
+		 *				Hidden files (such as the preview index) are never reported.
+		 * @returns		The changes in the order they occurred, or std::nullopt when changes may have been missed & the directory must be rescanned.
+		 */
+		std::optional<std::vector<Change>> poll()
+		{
+		#ifdef OS_LINUX
+			if (_broken || _fd == -1)
+				return std::nullopt;
+
+			std::vector<Change> changes;
+			alignas(inotify_event) char buffer[16384];
+			for (ssize_t len; (len = read(_fd, buffer, sizeof(buffer))) != 0; ) {
+				if (len == -1) {
+					if (errno == EINTR)
+						continue;
+					if (errno == EAGAIN || errno == EWOULDBLOCK)
+						break;
+					_broken = true;
+					return std::nullopt;
+				}
+				for (char* p{ buffer }; p < buffer + len; ) {
+					const auto* ev{ reinterpret_cast<const inotify_event*>(p) };
+					p += sizeof(inotify_event) + ev->len;
+
+					if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+						_broken = true;
+						return std::nullopt;
+					}
+					if ((ev->mask & IN_ISDIR) || ev->len == 0 || ev->name[0] == '.')
+						continue;
+					changes.emplace_back(Change{ (ev->mask & (IN_DELETE | IN_MOVED_FROM)) ? Change::Type::Removed : Change::Type::Added, ev->name });
+				}
+			}
+			return changes;
+		#else
+			return std::nullopt;
+		#endif
+		}
+	};
+}
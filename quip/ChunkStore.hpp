@@ -0,0 +1,482 @@
+#pragma once
+#include "SHA256.hpp"
+
+#include <make_exception.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace quip {
+	/**
+	 * @class	ChunkStore
+	 * @brief	Content-addressed store that splits data into content-defined chunks & saves each unique chunk exactly once.
+	 *			Chunk boundaries are found with a gear rolling hash, so an edit only changes the chunks that surround it.
+	 *			Chunks are named after the SHA-256 digest of their contents.
+	 *
+	 *			A manifest is the MANIFEST_HEADER followed by the raw digests of "manifest chunks", which are themselves stored
+	 *			in the chunk store & contain the raw digests of the data chunks.  Manifest chunks are split on content-defined
+	 *			boundaries too, so a small edit to a large entry only adds a few data chunks, one or two manifest chunks, and
+	 *			a manifest that is a few hundred bytes long.
+	 */
+	class ChunkStore {
+		std::filesystem::path _path;
+
+		/// @brief	Generates the gear table used by the rolling hash. (splitmix64)
+		static constexpr std::array<uint64_t, 256> makeGearTable()
+		{
+			std::array<uint64_t, 256> table{};
+			uint64_t state{ 0x9E3779B97F4A7C15ull };
+			for (auto& it : table) {
+				uint64_t z{ (state += 0x9E3779B97F4A7C15ull) };
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				it = z ^ (z >> 31);
+			}
+			return table;
+		}
+
+		/// @brief	Gets the length of the next chunk at the beginning of the given data.
+		static size_t nextBoundary(std::string_view const& data)
+		{
+			if (data.size() <= MIN_CHUNK_SIZE)
+				return data.size();
+			static constexpr std::array<uint64_t, 256> GEAR{ makeGearTable() };
+			const size_t end{ data.size() < MAX_CHUNK_SIZE ? data.size() : MAX_CHUNK_SIZE };
+			uint64_t hash{ 0ull };
+			for (size_t i{ MIN_CHUNK_SIZE }; i < end; ++i) {
+				hash = (hash << 1) + GEAR[static_cast<unsigned char>(data[i])];
+				if ((hash & BOUNDARY_MASK) == 0ull)
+					return i + 1;
+			}
+			return end;
+		}
+
+		/// @brief	Checks if the given digest ends a manifest chunk.  Uses 9 bits of the digest, resulting in ~512 digests per manifest chunk.
+		static bool isManifestBoundary(std::string_view const& digest)
+		{
+			return digest[0] == '\0' && (static_cast<unsigned char>(digest[1]) & 1u) == 0u;
+		}
+
+		/// @brief	Gets the filename of the chunk with the given raw digest.
+		static std::string toID(std::string_view const& digest)
+		{
+			static constexpr char HEX[]{ "0123456789abcdef" };
+			std::string id;
+			id.reserve(digest.size() * 2ull);
+			for (const auto& c : digest) {
+				id += HEX[static_cast<unsigned char>(c) >> 4];
+				id += HEX[static_cast<unsigned char>(c) & 0xF];
+			}
+			return id;
+		}
+
+		/// @brief	Gets a unique temporary path next to the given target, which can be renamed to it once it has been written completely.
+		static std::filesystem::path tempPath(std::filesystem::path const& target)
+		{
+			static std::mt19937_64 rng{ std::random_device{}() };
+			const uint64_t nonce{ rng() };
+			auto tmp{ target };
+			tmp += '.' + toID({ reinterpret_cast<const char*>(&nonce), sizeof(nonce) }) + ".tmp";
+			return tmp;
+		}
+
+		/**
+		 * @brief		Writes the given chunk to the store, unless it is already present.
+		 * @param chunk	The contents of the chunk.
+		 * @returns		The raw digest of the chunk.
+		 */
+		std::string put(std::string_view const& chunk) const
+		{
+			const auto& hash{ SHA256::hash(chunk) };
+			std::string digest(reinterpret_cast<const char*>(hash.data()), hash.size());
+			const auto& target{ chunkPath(toID(digest)) };
+			if (std::filesystem::exists(target)) {
+				// refresh the filetime of reused chunks so a concurrent prune() treats them as new
+				std::error_code ec;
+				std::filesystem::last_write_time(target, std::filesystem::file_time_type::clock::now(), ec);
+				return digest;
+			}
+
+			// write to a uniquely-named temporary file first, so an interrupted write can't leave a truncated chunk behind
+			//  and concurrent writers of the same chunk don't truncate each other's temporary file.
+			const auto& tmp{ tempPath(target) };
+			if (std::ofstream ofs{ tmp, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc }; ofs.is_open()) {
+				ofs.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+				ofs.close();
+				if (!ofs)
+					throw make_exception("Failed to write chunk '", target.filename(), "' to '", _path, "'!");
+			}
+			else throw make_exception("Failed to write chunk '", target.filename(), "' to '", _path, "'!");
+
+			std::error_code ec;
+			std::filesystem::rename(tmp, target, ec);
+			if (ec) {
+				std::filesystem::remove(tmp, ec);
+				// another process may have stored the same chunk first, which is just as good
+				if (!std::filesystem::exists(target))
+					throw make_exception("Failed to write chunk '", target.filename(), "' to '", _path, "'!");
+			}
+			return digest;
+		}
+
+		/// @brief	Reads the contents of the chunk with the given raw digest & appends them to the given string.
+		std::string& readChunk(std::string& out, std::string_view const& digest) const
+		{
+			return readChunkID(out, toID(digest));
+		}
+		/// @brief	Reads the contents of the chunk with the given identifier & appends them to the given string.
+		std::string& readChunkID(std::string& out, std::string const& id) const
+		{
+			const auto& path{ chunkPath(id) };
+			if (std::ifstream ifs{ path, std::ios_base::in | std::ios_base::binary }; ifs.is_open()) {
+				const auto& offset{ out.size() };
+				out.resize(offset + static_cast<size_t>(std::filesystem::file_size(path)));
+				ifs.read(out.data() + offset, static_cast<std::streamsize>(out.size() - offset));
+				out.resize(offset + static_cast<size_t>(ifs.gcount()));
+				return out;
+			}
+			throw make_exception("Chunk '", path.filename(), "' is missing from '", _path, "'!");
+		}
+
+		/**
+		 * @struct	Garbage
+		 * @brief	Chunks referenced by removed entries, which can be deleted once no remaining entry references them.
+		 */
+		struct Garbage {
+			/// @brief	Maps the filename of each manifest chunk to the filenames of the data chunks it references.
+			std::unordered_map<std::string, std::vector<std::string>> manifestChunks;
+		};
+
+		/// @brief	Adds the manifest chunks recorded in the given file, along with the data chunks they reference, to the given garbage.
+		void readGarbage(std::filesystem::path const& path, Garbage& garbage) const
+		{
+			std::ifstream ifs{ path, std::ios_base::in | std::ios_base::binary };
+			std::string digests;
+			for (std::string id; ifs >> id; ) {
+				// skip anything that isn't a chunk identifier, such as the remains of an interrupted write
+				if (id.size() != DIGEST_SIZE * 2ull || !std::all_of(id.begin(), id.end(), [](auto&& c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); }))
+					continue;
+				auto [it, inserted] { garbage.manifestChunks.try_emplace(id) };
+				if (!inserted)
+					continue;
+				digests.clear();
+				try {
+					readChunkID(digests, id);
+				} catch (const std::exception&) {
+					// already deleted
+					garbage.manifestChunks.erase(it);
+					continue;
+				}
+				for (std::string_view view{ digests }; view.size() >= DIGEST_SIZE; view.remove_prefix(DIGEST_SIZE))
+					it->second.emplace_back(toID(view.substr(0ull, DIGEST_SIZE)));
+			}
+		}
+
+		/**
+		 * @brief			Deletes the chunks in the given garbage that aren't referenced by any of the given manifests.
+		 *					Manifest chunks are kept as long as any of their unreferenced data chunks are, so those can be found again later.
+		 * @param garbage	Chunks referenced by removed entries.  Afterwards, only holds the manifest chunks that were kept for being too new.
+		 * @param remaining	Manifests of all remaining entries, read after the removed entries were deleted.
+		 * @param cutoff	Chunks with a filetime at or after this are kept, even when they appear to be unreferenced.
+		 * @returns			The number of chunks that were removed.
+		 */
+		size_t prune(Garbage& garbage, std::vector<std::string> const& remaining, std::filesystem::file_time_type const& cutoff) const
+		{
+			std::unordered_set<std::string> candidates;
+			for (const auto& [manifestID, dataIDs] : garbage.manifestChunks) {
+				candidates.emplace(manifestID);
+				candidates.insert(dataIDs.begin(), dataIDs.end());
+			}
+
+			std::unordered_set<std::string> visited;
+			std::string digests;
+			for (const auto& manifest : remaining) {
+				forEachManifestChunk(manifest, [&](std::string_view const& manifestDigest) {
+					auto id{ toID(manifestDigest) };
+					if (!visited.emplace(id).second)
+						return;
+					// identical manifest chunks reference identical data chunks, so those don't need to be read again
+					if (const auto& it{ garbage.manifestChunks.find(id) }; it != garbage.manifestChunks.end()) {
+						candidates.erase(id);
+						for (const auto& dataID : it->second)
+							candidates.erase(dataID);
+						return;
+					}
+					if (!std::filesystem::exists(chunkPath(id)))
+						return;
+					digests.clear();
+					readChunk(digests, manifestDigest);
+					for (std::string_view view{ digests }; view.size() >= DIGEST_SIZE; view.remove_prefix(DIGEST_SIZE))
+						candidates.erase(toID(view.substr(0ull, DIGEST_SIZE)));
+				});
+			}
+
+			size_t count{ 0ull };
+			std::unordered_set<std::string> kept;
+			const auto& tryRemove{ [&](std::string const& id) {
+				std::error_code ec;
+				const auto& path{ chunkPath(id) };
+				if (const auto& time{ std::filesystem::last_write_time(path, ec) }; ec)
+					return; //< already deleted
+				else if (time >= cutoff)
+					kept.emplace(id);
+				else if (std::filesystem::remove(path, ec))
+					++count;
+			} };
+			for (auto it{ garbage.manifestChunks.begin() }; it != garbage.manifestChunks.end(); ) {
+				auto& [manifestID, dataIDs] { *it };
+				if (!candidates.contains(manifestID)) {
+					it = garbage.manifestChunks.erase(it);
+					continue;
+				}
+				bool keepManifest{ false };
+				for (const auto& dataID : dataIDs) {
+					if (candidates.contains(dataID))
+						tryRemove(dataID);
+					if (kept.contains(dataID))
+						keepManifest = true;
+				}
+				if (keepManifest)
+					kept.emplace(manifestID);
+				else tryRemove(manifestID);
+
+				if (kept.contains(manifestID)) {
+					dataIDs.clear();
+					++it;
+				}
+				else it = garbage.manifestChunks.erase(it);
+			}
+			return count;
+		}
+
+	public:
+		/// @brief	The name of the chunk store directory, relative to the history directory.
+		static constexpr char DIRECTORY_NAME[]{ ".chunks" };
+		/// @brief	Prefix of a chunked entry's manifest.  Clipboard data never contains NUL bytes, so this can't collide with a regular entry.
+		static constexpr std::string_view MANIFEST_HEADER{ "\0quip-chunks\n", 13 };
+		/// @brief	The size of a raw SHA-256 digest, as stored in manifests.
+		static constexpr size_t DIGEST_SIZE{ std::tuple_size_v<SHA256::Digest> };
+		/// @brief	The maximum number of digests in a single manifest chunk.
+		static constexpr size_t MAX_MANIFEST_CHUNK_DIGESTS{ 1024ull };
+		/// @brief	Entries smaller than this are always stored whole.
+		static constexpr size_t MIN_ENTRY_SIZE{ 64ull * 1024ull };
+		static constexpr size_t MIN_CHUNK_SIZE{ 2ull * 1024ull };
+		static constexpr size_t MAX_CHUNK_SIZE{ 64ull * 1024ull };
+		/// @brief	Uses the top 13 bits of the rolling hash, resulting in an average chunk size of ~8 KiB past the minimum.
+		static constexpr uint64_t BOUNDARY_MASK{ ((1ull << 13) - 1ull) << (64 - 13) };
+
+		/// @brief	Chunks written or reused within this long before a sweep() started are never deleted by it, since the entry referencing them may not be written yet.
+		/// @brief	Garbage is only swept once it references at least 1/SWEEP_RATIO as many manifest chunks as there are remaining entries,
+		///			so the cost of reading every remaining entry is spread across that many removals.
+		static constexpr size_t SWEEP_RATIO{ 4ull };
+		/// @brief	The name of the file that defer() records the manifest chunks of removed entries in, relative to the chunk store directory.
+		static constexpr char PENDING_FILE_NAME[]{ ".pending" };
+		/// @brief	The name of the file that sweep() records the manifest chunks it couldn't delete yet in, relative to the chunk store directory.
+		static constexpr char DEFERRED_FILE_NAME[]{ ".deferred" };
+		static constexpr std::chrono::minutes PRUNE_GRACE_PERIOD{ 10 };
+
+		ChunkStore(std::filesystem::path const& path) : _path{ path } {}
+
+		/// @brief	Gets the chunk store belonging to the given history directory.
+		static ChunkStore of(std::filesystem::path const& history_directory)
+		{
+			return{ history_directory / DIRECTORY_NAME };
+		}
+
+		/// @brief	Gets the location of this chunk store on disk.
+		std::filesystem::path path() const { return _path; }
+
+		/// @brief	Gets the location of the chunk with the given identifier.
+		std::filesystem::path chunkPath(std::string const& id) const
+		{
+			return _path / id;
+		}
+
+		/// @brief	Checks if the given data begins with a manifest header.
+		static bool isManifest(std::string_view const& data)
+		{
+			return data.starts_with(MANIFEST_HEADER);
+		}
+
+		/**
+		 * @brief		Splits the given data into chunks & writes any chunks that aren't already present in the store.
+		 * @param data	The data to store.
+		 * @returns		The manifest describing the given data, which can be passed to read() to rebuild it.
+		 */
+		std::string store(std::string_view data) const
+		{
+			if (!std::filesystem::exists(_path))
+				std::filesystem::create_directories(_path);
+
+			std::string manifest{ MANIFEST_HEADER }, manifestChunk;
+			while (!data.empty()) {
+				const auto& chunk{ data.substr(0ull, nextBoundary(data)) };
+				const auto& digest{ put(chunk) };
+				data.remove_prefix(chunk.size());
+
+				manifestChunk += digest;
+				if (data.empty() || isManifestBoundary(digest) || manifestChunk.size() >= MAX_MANIFEST_CHUNK_DIGESTS * DIGEST_SIZE) {
+					manifest += put(manifestChunk);
+					manifestChunk.clear();
+				}
+			}
+			return manifest;
+		}
+
+		/**
+		 * @brief			Calls the given function with the raw digest of each manifest chunk referenced by the given manifest.
+		 * @param manifest	A manifest returned by store().
+		 * @param fn		Function that accepts a std::string_view.
+		 */
+		template<typename Fn>
+		static void forEachManifestChunk(std::string_view manifest, Fn&& fn)
+		{
+			for (manifest.remove_prefix(MANIFEST_HEADER.size()); manifest.size() >= DIGEST_SIZE; manifest.remove_prefix(DIGEST_SIZE))
+				fn(manifest.substr(0ull, DIGEST_SIZE));
+		}
+
+		/**
+		 * @brief			Calls the given function with the contents of each data chunk described by the given manifest, in order.
+		 *					Only one chunk is held in memory at a time.
+		 * @param manifest	A manifest returned by store().
+		 * @param fn		Function that accepts a std::string const& & returns false to stop early.
+		 * @returns			true when every chunk was visited; false when fn stopped early.
+		 */
+		template<typename Fn>
+		bool forEachChunk(std::string_view const& manifest, Fn&& fn) const
+		{
+			bool keepGoing{ true };
+			std::string digests, chunk;
+			forEachManifestChunk(manifest, [&](std::string_view const& manifestDigest) {
+				if (!keepGoing)
+					return;
+				digests.clear();
+				readChunk(digests, manifestDigest);
+				for (std::string_view view{ digests }; keepGoing && view.size() >= DIGEST_SIZE; view.remove_prefix(DIGEST_SIZE)) {
+					chunk.clear();
+					keepGoing = fn(readChunk(chunk, view.substr(0ull, DIGEST_SIZE)));
+				}
+			});
+			return keepGoing;
+		}
+
+		/**
+		 * @brief			Rebuilds the data described by a manifest by streaming each chunk into the given output stream.
+		 * @param os		Output stream to write to.
+		 * @param manifest	A manifest returned by store().
+		 * @returns			The os parameter.
+		 */
+		std::ostream& read(std::ostream& os, std::string_view const& manifest) const
+		{
+			forEachChunk(manifest, [&os](std::string const& chunk) {
+				os.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+				return true;
+			});
+			return os;
+		}
+		/**
+		 * @brief			Rebuilds the data described by a manifest by reading each chunk directly onto the end of the given string.
+		 * @param out		String to append to.
+		 * @param manifest	A manifest returned by store().
+		 * @returns			The out parameter.
+		 */
+		std::string& read(std::string& out, std::string_view const& manifest) const
+		{
+			std::string digests;
+			forEachManifestChunk(manifest, [&](std::string_view const& manifestDigest) {
+				digests.clear();
+				readChunk(digests, manifestDigest);
+				for (std::string_view view{ digests }; view.size() >= DIGEST_SIZE; view.remove_prefix(DIGEST_SIZE))
+					readChunk(out, view.substr(0ull, DIGEST_SIZE));
+			});
+			return out;
+		}
+
+		/**
+		 * @brief			Records the manifest chunks of removed entries, so that a later sweep() can delete the chunks that are no longer referenced.
+		 *					No chunks are read, so this costs the same regardless of how many entries remain.
+		 * @param manifests	Manifests of the removed entries.
+		 * @returns			true when the manifest chunks were recorded, otherwise false.
+		 */
+		bool defer(std::vector<std::string> const& manifests) const
+		{
+			std::string ids;
+			for (const auto& manifest : manifests)
+				forEachManifestChunk(manifest, [&ids](std::string_view const& manifestDigest) { ids += toID(manifestDigest) + '\n'; });
+			if (ids.empty())
+				return true;
+			if (std::ofstream ofs{ _path / PENDING_FILE_NAME, std::ios_base::out | std::ios_base::app | std::ios_base::binary }; ofs.is_open())
+				return static_cast<bool>(ofs.write(ids.data(), static_cast<std::streamsize>(ids.size())));
+			return false;
+		}
+
+		/// @brief	Gets the number of manifest chunks that were recorded by defer() since the last sweep().
+		size_t pending() const
+		{
+			std::error_code ec;
+			const auto& size{ std::filesystem::file_size(_path / PENDING_FILE_NAME, ec) };
+			return ec ? 0ull : static_cast<size_t>(size) / (DIGEST_SIZE * 2ull + 1ull);
+		}
+
+		/**
+		 * @brief			Deletes the chunks of removed entries that aren't referenced by any of the given manifests.
+		 *					Only chunks recorded by defer() are considered, so chunks & temporary files written by other processes are left alone.
+		 *					Chunks that are too new to delete are recorded again & retried by the next sweep().
+		 * @param remaining	Manifests of all remaining entries, read after the removed entries were deleted.
+		 * @param cutoff	Chunks with a filetime at or after this are kept, even when they appear to be unreferenced.
+		 * @returns			The number of chunks that were removed.
+		 */
+		size_t sweep(std::vector<std::string> const& remaining, std::filesystem::file_time_type const& cutoff) const
+		{
+			// take the pending list first, so that entries removed by other processes in the meantime are left for the next sweep
+			const auto& pendingPath{ _path / PENDING_FILE_NAME };
+			const auto& deferredPath{ _path / DEFERRED_FILE_NAME };
+			const auto& taken{ tempPath(pendingPath) };
+			std::error_code ec;
+			std::filesystem::rename(pendingPath, taken, ec);
+			const bool tookPending{ !ec };
+
+			Garbage garbage;
+			if (tookPending)
+				readGarbage(taken, garbage);
+			readGarbage(deferredPath, garbage);
+
+			const auto& count{ prune(garbage, remaining, cutoff) };
+
+			if (garbage.manifestChunks.empty())
+				std::filesystem::remove(deferredPath, ec);
+			else {
+				const auto& tmp{ tempPath(deferredPath) };
+				if (std::ofstream ofs{ tmp, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc }; ofs.is_open()) {
+					for (const auto& [manifestID, _] : garbage.manifestChunks)
+						ofs << manifestID << '\n';
+					ofs.close();
+					if (ofs)
+						std::filesystem::rename(tmp, deferredPath, ec);
+					if (!ofs || ec) {
+						// keep the pending list, so that nothing is forgotten
+						std::filesystem::remove(tmp, ec);
+						if (tookPending)
+							std::filesystem::rename(taken, pendingPath, ec);
+						return count;
+					}
+				}
+				else return count;
+			}
+			if (tookPending)
+				std::filesystem::remove(taken, ec);
+			return count;
+		}
+	};
+}
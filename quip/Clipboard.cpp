@@ -12,23 +12,25 @@ using namespace quip;
 void quip::Clipboard::set_raw(const char* data) const
 {
 #ifdef OS_WIN
-	const auto& len{ strlen(data) + 1 };
+	if (this->useSystemClipboard) {
+		const auto& len{ strlen(data) + 1 };
 
-	// allocate global memory for data
-	auto hMem{ GlobalAlloc(GMEM_MOVEABLE, len) };
-	if (hMem == NULL)
-		throw make_exception("Failed to allocate memory for incoming data!");
-	// copy data to global memory
-#	pragma warning(disable:6387)
-	memcpy(GlobalLock(hMem), data, len);
-#	pragma warning(default:6387)
-	GlobalUnlock(hMem);
-	// open, empty, and set the clipboard data to the global memory, then close the clipboard
-	if (!OpenClipboard(NULL))
-		return;
-	EmptyClipboard();
-	SetClipboardData(CF_TEXT, hMem);
-	CloseClipboard();
+		// allocate global memory for data
+		auto hMem{ GlobalAlloc(GMEM_MOVEABLE, len) };
+		if (hMem == NULL)
+			throw make_exception("Failed to allocate memory for incoming data!");
+		// copy data to global memory
+#		pragma warning(disable:6387)
+		memcpy(GlobalLock(hMem), data, len);
+#		pragma warning(default:6387)
+		GlobalUnlock(hMem);
+		// open, empty, and set the clipboard data to the global memory, then close the clipboard
+		if (!OpenClipboard(NULL))
+			return;
+		EmptyClipboard();
+		SetClipboardData(CF_TEXT, hMem);
+		CloseClipboard();
+	}
 #endif
 
 	if (this->useHistory)
@@ -37,36 +39,40 @@ void quip::Clipboard::set_raw(const char* data) const
 std::string quip::Clipboard::get(bool const& throwOnInvalidFormat) const
 {
 #ifdef OS_WIN
-	HANDLE ret{ nullptr };
-	if (!OpenClipboard(NULL))
-		return{};
-	if (IsClipboardFormatAvailable(CF_TEXT))
-		ret = GetClipboardData(CF_TEXT);
-	else if (throwOnInvalidFormat)
-		throw make_exception("Clipboard does not contain plaintext!");
-	CloseClipboard();
+	if (this->useSystemClipboard) {
+		HANDLE ret{ nullptr };
+		if (!OpenClipboard(NULL))
+			return{};
+		if (IsClipboardFormatAvailable(CF_TEXT))
+			ret = GetClipboardData(CF_TEXT);
+		else if (throwOnInvalidFormat)
+			throw make_exception("Clipboard does not contain plaintext!");
+		CloseClipboard();
 
-	if (ret != nullptr)
-		return{ (char*)ret };
-#else
+		if (ret != nullptr)
+			return{ (char*)ret };
+		return{};
+	}
+#endif
 	if (this->useHistory)
 		if (const auto& latest{ history.get_latest() }; latest.has_value())
 			return latest.value().str();
-#endif
 	return{};
 }
 
 void quip::Clipboard::clear() const
 {
 #ifdef OS_WIN
-	if (!OpenClipboard(NULL))
+	if (this->useSystemClipboard) {
+		if (!OpenClipboard(NULL))
+			return;
+		EmptyClipboard();
+		CloseClipboard();
 		return;
-	EmptyClipboard();
-	CloseClipboard();
-#else
+	}
+#endif
 	if (this->useHistory)
 		history.push();
-#endif
 }
 
 template<var::Streamable... Ts>
@@ -18,8 +18,10 @@ namespace quip {
 	public:
 		mutable History history;
 		bool useHistory;
+		/// @brief	When false, this clipboard is a named register that is stored only in its history, and never touches the system clipboard.
+		bool useSystemClipboard;
 
-		Clipboard(std::filesystem::path const& history_directory, const bool useHistory, const bool initHistoryCache = true) : history{ history_directory, useHistory && initHistoryCache }, useHistory{ useHistory } {}
+		Clipboard(std::filesystem::path const& history_directory, const bool useHistory, const bool initHistoryCache = true, const bool chunkHistory = false, const bool useSystemClipboard = true) : history{ history_directory, useHistory && initHistoryCache, chunkHistory }, useHistory{ useHistory }, useSystemClipboard{ useSystemClipboard } {}
 
 		template<var::Streamable... Ts>
 		void set(Ts&&...) const;
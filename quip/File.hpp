@@ -1,8 +1,14 @@
 #pragma once
+#include "ChunkStore.hpp"
+
 #include <fileio.hpp>
 #include <fileutil.hpp>
 
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
 #include <utility>
 
 namespace quip {
@@ -62,6 +68,25 @@ namespace quip {
 		{
 			return file::exists(path);
 		}
+		/// @brief	Gets the manifest of this entry if it is stored in the history directory's chunk store; otherwise std::nullopt.
+		std::optional<std::string> manifest() const
+		{
+			std::ifstream ifs{ path, std::ios_base::in | std::ios_base::binary };
+			std::string data(ChunkStore::MANIFEST_HEADER.size(), '\0');
+			if (!ifs.read(data.data(), static_cast<std::streamsize>(data.size())) || !ChunkStore::isManifest(data))
+				return std::nullopt;
+			data.append(std::istreambuf_iterator<char>{ ifs }, std::istreambuf_iterator<char>{});
+			return data;
+		}
+		/// @brief	Streams the contents of this entry to the given output stream, rebuilding it from the chunk store when necessary.
+		std::ostream& write_to(std::ostream& os) const
+		{
+			if (const auto& m{ manifest() }; m.has_value())
+				return ChunkStore::of(path.parent_path()).read(os, m.value());
+			if (std::ifstream ifs{ path, std::ios_base::in | std::ios_base::binary }; ifs.is_open() && ifs.peek() != std::ifstream::traits_type::eof())
+				os << ifs.rdbuf();
+			return os;
+		}
 		/// @brief	Deletes the contents of this file.
 		void clear()
 		{
@@ -77,12 +102,49 @@ namespace quip {
 		}
 		std::stringstream get() const
 		{
+			if (const auto& m{ manifest() }; m.has_value()) {
+				std::stringstream ss;
+				ChunkStore::of(path.parent_path()).read(ss, m.value());
+				return ss;
+			}
 			return file::read(path);
 		}
 
+		/// @brief	Gets the contents of this entry as a string, rebuilding it from the chunk store when necessary.
+		std::string str() const
+		{
+			std::string data;
+			if (std::ifstream ifs{ path, std::ios_base::in | std::ios_base::binary }; ifs.is_open()) {
+				data.resize(static_cast<size_t>(std::filesystem::file_size(path)));
+				ifs.read(data.data(), static_cast<std::streamsize>(data.size()));
+				data.resize(static_cast<size_t>(ifs.gcount()));
+			}
+			if (ChunkStore::isManifest(data)) {
+				std::string out;
+				ChunkStore::of(path.parent_path()).read(out, data);
+				return out;
+			}
+			return data;
+		}
+
 		Preview getPreview(std::optional<size_t> const& maxLength, std::optional<size_t> const& maxLines, bool const& useEllipsis) const
 		{
-			return{ std::move(file::read(path)), maxLength, maxLines, useEllipsis };
+			if (const auto& m{ manifest() }; m.has_value()) {
+				// only rebuild as many chunks as are needed to show the requested number of lines
+				std::stringstream buffer;
+				if (maxLines != 0ull) {
+					size_t lines{ 0ull };
+					ChunkStore::of(path.parent_path()).forEachChunk(m.value(), [&](std::string const& chunk) {
+						buffer.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+						if (!maxLines.has_value())
+							return true;
+						lines += static_cast<size_t>(std::count(chunk.begin(), chunk.end(), Preview::LINE_DELIMITER));
+						return lines < maxLines.value();
+					});
+				}
+				return{ std::move(buffer), maxLength, maxLines, useEllipsis };
+			}
+			return{ file::read(path), maxLength, maxLines, useEllipsis };
 		}
 
 		operator std::filesystem::path() const { return path; }
@@ -94,7 +156,7 @@ namespace quip {
 		}
 		friend std::ostream& operator<<(std::ostream& os, const File& f)
 		{
-			return os << f.get().rdbuf();
+			return f.write_to(os);
 		}
 	};
 }
@@ -0,0 +1,110 @@
+#pragma once
+#include <make_exception.hpp>
+#include <sysarch.h>
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef OS_WIN
+#include <fcntl.h>
+#include <io.h>
+
+#include <cstdio>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#endif
+
+namespace quip {
+	/**
+	 * @class	GatherWriter
+	 * @brief	Collects output buffers & writes them to a file descriptor with as few gathered writes (writev) as possible.
+	 *			On Windows, buffers are written to STDOUT individually instead, which is switched to binary mode so that entries are written unmodified.
+	 */
+	class GatherWriter {
+		int _fd;
+		std::vector<std::string> _buffers;
+		size_t _pending{ 0ull };
+
+	#ifdef OS_WIN
+		static constexpr size_t MAX_BUFFERS{ 1024ull };
+	#elif defined(IOV_MAX)
+		static constexpr size_t MAX_BUFFERS{ IOV_MAX };
+	#else
+		static constexpr size_t MAX_BUFFERS{ 1024ull };
+	#endif
+		/// @brief	Pending data is flushed once it exceeds this many bytes.
+		static constexpr size_t MAX_PENDING{ 8ull * 1024ull * 1024ull };
+
+	public:
+		GatherWriter(int const& fd = 1) : _fd{ fd }
+		{
+		#ifdef OS_WIN
+			std::cout.flush();
+			_setmode(_fileno(stdout), _O_BINARY);
+		#endif
+		}
+		GatherWriter(GatherWriter const&) = delete;
+		GatherWriter& operator=(GatherWriter const&) = delete;
+		~GatherWriter()
+		{
+			try {
+				flush();
+			} catch (...) {}
+		}
+
+		/// @brief	Queues the given buffer to be written, flushing first when the queue is full.
+		void push(std::string&& buffer)
+		{
+			if (buffer.empty())
+				return;
+			if (_buffers.size() >= MAX_BUFFERS || (_pending > 0ull && _pending + buffer.size() > MAX_PENDING))
+				flush();
+			_pending += buffer.size();
+			_buffers.emplace_back(std::move(buffer));
+		}
+
+		/// @brief	Writes all queued buffers.
+		void flush()
+		{
+			if (_buffers.empty())
+				return;
+			// take the queue before writing, so that a failed write isn't repeated by the next flush
+			auto buffers{ std::exchange(_buffers, {}) };
+			_pending = 0ull;
+		#ifdef OS_WIN
+			for (const auto& buffer : buffers)
+				std::cout.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			if (!std::cout.flush())
+				throw make_exception("Failed to write output!");
+		#else
+			std::vector<iovec> iov;
+			iov.reserve(buffers.size());
+			for (auto& buffer : buffers)
+				iov.emplace_back(iovec{ buffer.data(), buffer.size() });
+
+			for (size_t i{ 0ull }; i < iov.size(); ) {
+				const auto& written{ writev(_fd, iov.data() + i, static_cast<int>(iov.size() - i)) };
+				if (written == -1) {
+					if (errno == EINTR)
+						continue;
+					throw make_exception("Failed to write output!");
+				}
+				// skip past the buffers that were completely written, then advance into the partially-written one
+				auto n{ static_cast<size_t>(written) };
+				for (; i < iov.size() && n >= iov[i].iov_len; ++i)
+					n -= iov[i].iov_len;
+				if (n > 0ull) {
+					iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + n;
+					iov[i].iov_len -= n;
+				}
+			}
+		#endif
+		}
+	};
+}
@@ -1,13 +1,23 @@
 #pragma once
+#include "ChangeFeed.hpp"
 #include "File.hpp"
 #include "HexSequencer.hpp"
+#include "PreviewIndex.hpp"
 
 #include <fileio.hpp>
 #include <fileutil.hpp>
 #include <str.hpp>
 
+#include <algorithm>
 #include <deque>
 #include <filesystem>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace quip {
 	/**
@@ -18,54 +28,143 @@ namespace quip {
 		std::filesystem::path _path;
 		std::deque<File> _cache;
 		HexSequencer _sequencer;
+		bool _chunked;
+		/// @brief	Filenames & filetimes of all cached entries, for fast membership checks & ordering without checking the filesystem again.
+		std::unordered_map<std::string, std::filesystem::file_time_type> _times;
+		/// @brief	Optional feed of changes to the history directory, used by refresh() to avoid rescanning it.
+		std::optional<ChangeFeed> _feed;
 
 		/**
-		 * @brief			Refreshes the given file cache from the given directory.
-		 * @param files		Reference of a deque containing the currently-cached files.
-		 * @param path		The location of the target directory.
-		 * @returns			The reference of the 'files' parameter.
+		 * @brief			Checks if the given directory entry is a history entry.
+		 *					Hidden files & directories (such as the chunk store) are excluded.
+		 * @param entry		A directory entry from the history directory.
+		 * @returns			true when the entry is a history entry; otherwise false.
 		 */
-		static std::deque<File>& refreshAllFiles(std::deque<File>& files, std::filesystem::path const& path, const bool& includeSymlinks = false)
+		static bool isEntry(std::filesystem::directory_entry const& entry, const bool& includeSymlinks = false)
 		{
-			for (std::filesystem::directory_iterator it{ path }, end{}; it != end; ++it) {
-				if (it->is_regular_file() && (!includeSymlinks || !it->is_symlink()) && std::find_if(files.begin(), files.end(), [&it](auto const& file) { return file.path == it->path(); }) == files.end()) {
-					files.emplace_back(File{ it->path() });
-				}
-			}
-
-			files.shrink_to_fit();
-			std::sort(files.begin(), files.end(), [](auto&& l, auto&& r) { return l.last_write_time() > r.last_write_time(); });
+			return entry.is_regular_file() && (!includeSymlinks || !entry.is_symlink()) && !entry.path().filename().generic_string().starts_with('.');
+		}
 
-			return files;
+		/**
+		 * @brief		Sorts the given files from newest to oldest, checking the filetime of each file only once.
+		 * @param files	The files to sort.
+		 * @returns		A vector containing the sorted files, paired with their filetimes.
+		 */
+		static std::vector<std::pair<std::filesystem::file_time_type, File>> sortByNewest(std::vector<File>&& files)
+		{
+			std::vector<std::pair<std::filesystem::file_time_type, File>> timed;
+			timed.reserve(files.size());
+			for (auto&& file : files) {
+				const auto& time{ file.last_write_time() };
+				timed.emplace_back(time, std::move(file));
+			}
+			std::sort(timed.begin(), timed.end(), [](auto&& l, auto&& r) { return l.first > r.first; });
+			return timed;
 		}
 		/**
 		 * @brief		Gets all of the files present in the given path.
 		 * @param path	The location of the target directory.
-		 * @returns		A deque containing all of the files in path.
+		 * @returns		A vector containing all of the files in path from newest to oldest, paired with their filetimes.
 		 */
-		static std::deque<File> getAllFiles(std::filesystem::path const& path, const bool& includeSymlinks = false)
+		static std::vector<std::pair<std::filesystem::file_time_type, File>> getAllFiles(std::filesystem::path const& path, const bool& includeSymlinks = false)
 		{
-			std::deque<File> files;
+			std::vector<File> files;
 
-			for (std::filesystem::recursive_directory_iterator it{ path }, end{}; it != end; ++it)
-				if (it->is_regular_file() && (!includeSymlinks || !it->is_symlink()))
+			for (std::filesystem::directory_iterator it{ path }, end{}; it != end; ++it)
+				if (isEntry(*it, includeSymlinks))
 					files.emplace_back(File{ it->path() });
 
-			files.shrink_to_fit();
-			std::sort(files.begin(), files.end(), [](auto&& l, auto&& r) { return l.last_write_time() > r.last_write_time(); });
+			return sortByNewest(std::move(files));
+		}
+
+		/**
+		 * @brief			Applies the given changes to the file cache.
+		 *					New entries are merged into the existing order instead of re-sorting the whole cache.
+		 *					Entries are never modified in place, so an 'Added' change for a cached entry is ignored unless it was also removed.
+		 * @param changes	The changes to apply, in the order they occurred.
+		 * @returns			The changes that actually modified the cache.
+		 */
+		std::vector<Change> apply(std::vector<Change> const& changes)
+		{
+			// reduce the changes to the final state of each entry
+			struct State { bool removed{ false }, present{ false }; };
+			std::unordered_map<std::string, State> states;
+			std::vector<std::string> order;
+			for (const auto& change : changes) {
+				auto [it, inserted] { states.try_emplace(change.name) };
+				if (inserted)
+					order.emplace_back(change.name);
+				if (change.type == Change::Type::Removed) {
+					it->second.removed = true;
+					it->second.present = false;
+				}
+				else it->second.present = true;
+			}
 
-			return files;
+			std::vector<Change> applied;
+			std::unordered_set<std::string> removed;
+			std::vector<File> added;
+			for (const auto& name : order) {
+				const auto& state{ states[name] };
+				const bool cached{ _times.contains(name) };
+				if (cached && (state.removed || !state.present)) {
+					removed.emplace(name);
+					_times.erase(name);
+					applied.emplace_back(Change{ Change::Type::Removed, name });
+				}
+				if (state.present && (!cached || state.removed)) {
+					if (const auto& path{ _path / name }; std::filesystem::is_regular_file(path)) {
+						added.emplace_back(File{ path });
+						applied.emplace_back(Change{ Change::Type::Added, name });
+					}
+				}
+			}
+
+			if (!removed.empty())
+				std::erase_if(_cache, [&removed](auto&& f) { return removed.contains(f.name()); });
+
+			// insert the new entries (oldest first) at their sorted position; this is usually the front of the cache
+			auto sorted{ sortByNewest(std::move(added)) };
+			for (auto it{ sorted.rbegin() }; it != sorted.rend(); ++it) {
+				auto& [time, file] { *it };
+				const auto& pos{ std::find_if(_cache.begin(), _cache.end(), [this, &time](auto&& f) { return _times.at(f.name()) <= time; }) };
+				_times.insert_or_assign(file.name(), time);
+				_cache.insert(pos, std::move(file));
+			}
+
+			return applied;
 		}
 
 		/**
-		 * @brief		Gets all of the files present in the cache directory.
-		 * @returns		A deque containing all of the files in the cache directory.
+		 * @brief		Scans the history directory for entries that were added or removed since the cache was last updated.
+		 * @returns		The changes that were found.
 		 */
-		std::deque<File> getAllFiles() const
+		std::vector<Change> scan(const bool& includeSymlinks = false) const
 		{
-			if (!file::exists(_path))
-				std::filesystem::create_directories(_path);
-			return getAllFiles(_path);
+			std::vector<Change> changes;
+			if (!file::exists(_path)) {
+				for (const auto& [name, _] : _times)
+					changes.emplace_back(Change{ Change::Type::Removed, name });
+				return changes;
+			}
+
+			size_t found{ 0ull };
+			std::unordered_set<std::string> present;
+			for (std::filesystem::directory_iterator it{ _path }, end{}; it != end; ++it) {
+				if (isEntry(*it, includeSymlinks)) {
+					auto name{ it->path().filename().generic_string() };
+					if (_times.contains(name))
+						++found;
+					else changes.emplace_back(Change{ Change::Type::Added, name });
+					present.emplace(std::move(name));
+				}
+			}
+			if (found != _times.size()) {
+				for (const auto& [name, _] : _times)
+					if (!present.contains(name))
+						changes.emplace_back(Change{ Change::Type::Removed, name });
+			}
+			return changes;
 		}
 
 		/**
@@ -88,13 +187,94 @@ namespace quip {
 			return largest;
 		}
 
+		/**
+		 * @brief			Writes the given manifest to the given entry, unmodified.
+		 *					It is written to a hidden temporary file first & then renamed, so an interrupted write can't leave a truncated manifest behind.
+		 * @param path		The location of the entry.
+		 * @param manifest	A manifest returned by ChunkStore::store().
+		 * @returns			true when the manifest was written successfully, otherwise false.
+		 */
+		static bool writeManifest(std::filesystem::path const& path, std::string const& manifest)
+		{
+			static std::mt19937_64 rng{ std::random_device{}() };
+			const auto& tmp{ path.parent_path() / ('.' + path.filename().string() + '.' + std::to_string(rng()) + ".tmp") };
+			if (std::ofstream ofs{ tmp, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc }; ofs.is_open()) {
+				ofs.write(manifest.data(), static_cast<std::streamsize>(manifest.size()));
+				ofs.close();
+				std::error_code ec;
+				if (ofs)
+					std::filesystem::rename(tmp, path, ec);
+				if (!ofs || ec) {
+					std::filesystem::remove(tmp, ec);
+					return false;
+				}
+				return true;
+			}
+			return false;
+		}
+
+		/**
+		 * @brief		Deletes the cache entries from the given index to the end of the cache.
+		 *				Chunks that only they referenced are recorded & deleted in batches by ChunkStore::sweep().
+		 *				Stale preview records are left for PreviewIndex compaction.
+		 * @param index	The index of the first entry to delete.
+		 * @returns		The number of entries that were deleted.
+		 */
+		int erase_from(const size_t& index)
+		{
+			if (index >= _cache.size())
+				return 0;
+			const auto& store{ ChunkStore::of(_path) };
+			std::vector<std::string> removed;
+			for (auto it{ _cache.begin() + index }; it != _cache.end(); ++it) {
+				if (auto manifest{ it->manifest() }; manifest.has_value())
+					removed.emplace_back(std::move(manifest.value()));
+				if (it->exists() && !std::filesystem::remove(it->path))
+					throw make_exception("Failed to remove file at '", it->path, "'!");
+				_times.erase(it->name());
+			}
+			const int count{ static_cast<int>(_cache.size() - index) };
+			_cache.erase(_cache.begin() + index, _cache.end());
+
+			if (!removed.empty())
+				store.defer(removed);
+			// only sweep once enough garbage has accumulated, so that reading every remaining entry is spread across many removals
+			if (const auto& pending{ store.pending() }; pending > 0ull && pending >= _cache.size() / ChunkStore::SWEEP_RATIO) {
+				// rescan the directory instead of trusting the cache, since other processes may have pushed entries that share these chunks
+				const auto& scanStart{ std::filesystem::file_time_type::clock::now() };
+				std::vector<std::string> remaining;
+				for (std::filesystem::directory_iterator it{ _path }, end{}; it != end; ++it)
+					if (isEntry(*it))
+						if (auto manifest{ File{ it->path() }.manifest() }; manifest.has_value())
+							remaining.emplace_back(std::move(manifest.value()));
+				store.sweep(remaining, scanStart - ChunkStore::PRUNE_GRACE_PERIOD);
+			}
+			return count;
+		}
+
 	public:
-		History(std::filesystem::path const& path, bool const& initCache = true) : _path{ path }, _cache{ initCache ? getAllFiles() : std::deque<File>{} }, _sequencer{ getLargestCachedIndex() } {}
+		/// @brief	The preview index is never compacted while it holds this many records or fewer.
+		static constexpr size_t COMPACT_PREVIEWS_THRESHOLD{ 64ull };
+
+		History(std::filesystem::path const& path, bool const& initCache = true, bool const& chunked = false) : _path{ path }, _sequencer{ 0u }, _chunked{ chunked }
+		{
+			if (!initCache)
+				return;
+			if (!file::exists(_path))
+				std::filesystem::create_directories(_path);
+			for (auto&& [time, file] : getAllFiles(_path)) {
+				_times.emplace(file.name(), time);
+				_cache.emplace_back(std::move(file));
+			}
+			_sequencer = HexSequencer{ getLargestCachedIndex() };
+		}
 
 		/// @brief	Deletes all cache files, including the directory where they are located.
 		int delete_all()
 		{
+			_feed.reset();
 			_cache.clear();
+			_times.clear();
 			return std::filesystem::remove_all(_path);
 		}
 
@@ -102,41 +282,114 @@ namespace quip {
 		int delete_older_than(const std::filesystem::file_time_type& time_threshold)
 		{
 			refresh();
-			int count{ 0 };
-			for (size_t i{ 0ull }, end{ _cache.size() }; i < end; ++i) {
-				const auto& file{ _cache[i] };
-				if (file.last_write_time() > time_threshold) {
-					if (file.exists() && !std::filesystem::remove(file.path))
-						throw make_exception("Failed to remove file at '", file.path, "'!");
-					count = _cache.size() - i;
-					// remove until the end of the cache, then break since refresh() sorts by last modified.
-					_cache.erase(_cache.begin() + i, _cache.end());
-					break;
-				}
-			}
-			return count;
+			// the cache is sorted from newest to oldest, so every entry after the first old one is also old.
+			const auto& first{ std::find_if(_cache.begin(), _cache.end(), [this, &time_threshold](auto&& f) { return _times.at(f.name()) < time_threshold; }) };
+			return erase_from(static_cast<size_t>(std::distance(_cache.begin(), first)));
+		}
+
+		/**
+		 * @brief			Deletes the oldest cache entries until no more than the given number remain.
+		 * @param max_count	The maximum number of entries to keep.
+		 * @returns			The number of entries that were deleted.
+		 */
+		int delete_all_but(const size_t& max_count)
+		{
+			return erase_from(max_count);
 		}
 
 		/// @brief	Gets the location of this file on disk.
 		std::filesystem::path path() const { return _path; }
 
-		/// @brief	Refreshes the cache from the filesystem.
-		void refresh()
+		/**
+		 * @brief		Starts watching the history directory, so that refresh() only has to apply the changes reported since the last refresh.
+		 *				This is only useful for long-lived instances, and has no effect on platforms where ChangeFeed isn't supported.
+		 */
+		void watch()
+		{
+			if (!ChangeFeed::is_supported() || _feed.has_value())
+				return;
+			if (!file::exists(_path))
+				std::filesystem::create_directories(_path);
+			_feed.emplace(_path);
+			// catch anything that changed before the feed was started
+			apply(scan());
+		}
+		/// @brief	Stops watching the history directory.
+		void unwatch() { _feed.reset(); }
+		/// @brief	Checks if the history directory is being watched.
+		bool watching() const { return _feed.has_value(); }
+
+		/**
+		 * @brief		Refreshes the cache from the filesystem.
+		 *				When the directory is being watched, only the changes reported by the feed are applied; otherwise the directory is rescanned.
+		 * @returns		The entries that were added to or removed from the cache.
+		 */
+		std::vector<Change> refresh()
 		{
-			refreshAllFiles(_cache, _path);
+			if (_feed.has_value()) {
+				if (const auto& changes{ _feed->poll() }; changes.has_value())
+					return apply(changes.value());
+				// the feed lost track of the directory, try to restart it & fall back to a rescan
+				_feed.reset();
+				try {
+					if (file::exists(_path))
+						_feed.emplace(_path);
+				} catch (const std::exception&) {
+					// e.g. the inotify watch limit was reached; keep going without a feed
+					_feed.reset();
+				}
+			}
+			return apply(scan());
 		}
 
+		/// @brief	Gets whether large entries are split into content-defined chunks when they are pushed.
+		bool chunked() const { return _chunked; }
+
 		/// @brief	Push a new entry to the cache.
 		template<var::Streamable... Ts>
 		bool push(Ts&&... data)
 		{
 			if (!file::exists(_path))
 				std::filesystem::create_directories(_path);
-			if (const auto& filepath{ _path / _sequencer.get() }; file::write(filepath, std::forward<Ts>(data)...)) {
-				_cache.emplace_front(File{ filepath });
-				return true;
+
+			std::string s;
+			if constexpr (sizeof...(Ts) > 0)
+				s = str::stringify(std::forward<Ts>(data)...);
+
+			const auto& name{ _sequencer.get() };
+			const auto& filepath{ _path / name };
+			// split large entries into chunks so near-duplicates share storage with earlier entries
+			if (_chunked && s.size() >= ChunkStore::MIN_ENTRY_SIZE) {
+				if (!writeManifest(filepath, ChunkStore::of(_path).store(s)))
+					return false;
 			}
-			return false;
+			else if (!file::write(filepath, s))
+				return false;
+
+			_cache.emplace_front(File{ filepath });
+			_times.insert_or_assign(name, std::filesystem::last_write_time(filepath));
+			// a missing preview record isn't fatal; previews fall back to reading the entry
+			PreviewIndex::of(_path).append(PreviewRecord::make(name, s));
+			return true;
+		}
+
+		/**
+		 * @brief		Loads the preview records of the given cache entries.
+		 *				When most of the records in the index are stale or some are damaged, the index is compacted first.
+		 * @param names	The filenames of the entries to load records for.
+		 */
+		PreviewIndex previews(std::unordered_set<std::string> const& names) const
+		{
+			auto index{ PreviewIndex::of(_path) };
+			// an empty cache may just not have been loaded, so don't treat every record as stale
+			if (index.load(names); !_times.empty() && (index.corrupt() || (index.total() > COMPACT_PREVIEWS_THRESHOLD && index.total() > 2ull * _times.size()))) {
+				std::unordered_set<std::string> live;
+				for (const auto& [name, _] : _times)
+					live.emplace(name);
+				if (index.compact(live))
+					index.load(names);
+			}
+			return index;
 		}
 
 		/// @brief	Retrieves the latest cache data.
@@ -168,7 +421,7 @@ namespace quip {
 		/// @brief	Gets the (first) File with the given filetime.
 		std::optional<File> get(const std::filesystem::file_time_type& file_time) const
 		{
-			if (const auto& it{ std::find_if(_cache.begin(), _cache.end(), [&file_time](auto&& f) { return f.last_write_time() == file_time; }) }; it != _cache.end())
+			if (const auto& it{ std::find_if(_cache.begin(), _cache.end(), [this, &file_time](auto&& f) { return _times.at(f.name()) == file_time; }) }; it != _cache.end())
 				return *it;
 			return std::nullopt;
 		}
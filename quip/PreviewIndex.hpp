@@ -0,0 +1,296 @@
+#pragma once
+#include "File.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace quip {
+	/**
+	 * @struct	PreviewRecord
+	 * @brief	Small summary of a history entry that is recorded when it is pushed, so previews can be shown without reading the entry.
+	 */
+	struct PreviewRecord {
+		/// @brief	The maximum number of lines stored in a record.
+		static constexpr size_t MAX_LINES{ 10ull };
+		/// @brief	The maximum width of each line stored in a record.
+		static constexpr size_t MAX_WIDTH{ 256ull };
+		/// @brief	The largest body a record can have.
+		static constexpr size_t MAX_BODY_SIZE{ MAX_LINES * (MAX_WIDTH + 1ull) };
+		/// @brief	The first character of each record's header line.
+		static constexpr char HEADER_PREFIX{ '#' };
+		/// @brief	The number of hex digits in the checksum that follows the HEADER_PREFIX.
+		static constexpr size_t CHECKSUM_WIDTH{ 16ull };
+
+		/// @brief	The filename of the entry this record belongs to.
+		std::string name;
+		/// @brief	The size of the entry, in bytes.
+		size_t bytes{ 0ull };
+		/// @brief	The number of lines in the entry.
+		size_t lines{ 0ull };
+		/// @brief	The length of the longest line in head, before it was truncated.
+		size_t widest{ 0ull };
+		/// @brief	Whether the entry ends with a line delimiter.
+		bool trailingDelimiter{ false };
+		/// @brief	The first lines of the entry, truncated to MAX_WIDTH.
+		std::vector<std::string> head;
+
+		/**
+		 * @brief		Creates a preview record for the given entry data.
+		 * @param name	The filename of the entry.
+		 * @param data	The contents of the entry.
+		 */
+		static PreviewRecord make(std::string const& name, std::string_view data)
+		{
+			PreviewRecord rec;
+			rec.name = name;
+			rec.bytes = data.size();
+			rec.trailingDelimiter = !data.empty() && data.back() == File::Preview::LINE_DELIMITER;
+
+			while (!data.empty()) {
+				const auto& pos{ data.find(File::Preview::LINE_DELIMITER) };
+				const auto& line{ data.substr(0ull, pos) };
+				if (rec.head.size() < MAX_LINES) {
+					rec.head.emplace_back(line.substr(0ull, MAX_WIDTH));
+					if (line.size() > rec.widest)
+						rec.widest = line.size();
+				}
+				++rec.lines;
+				if (pos == std::string_view::npos)
+					break;
+				data.remove_prefix(pos + 1);
+			}
+			return rec;
+		}
+
+		/// @brief	Checks if this record contains enough of the entry to show a preview with the given dimensions.
+		bool covers(std::optional<size_t> const& maxLength, std::optional<size_t> const& maxLines) const
+		{
+			if (maxLines == 0ull)
+				return true;
+			const bool enoughLines{ head.size() == lines || (maxLines.has_value() && maxLines.value() <= head.size()) };
+			const bool enoughWidth{ widest <= MAX_WIDTH || (maxLength.has_value() && maxLength.value() <= MAX_WIDTH) };
+			return enoughLines && enoughWidth;
+		}
+
+		/// @brief	Gets a preview of the entry from this record.  Only valid when covers() returns true for the same dimensions.
+		File::Preview getPreview(std::optional<size_t> const& maxLength, std::optional<size_t> const& maxLines, bool const& useEllipsis) const
+		{
+			std::stringstream buffer;
+			for (size_t i{ 0ull }; i < head.size(); ++i) {
+				if (i > 0ull) buffer << File::Preview::LINE_DELIMITER;
+				buffer << head[i];
+			}
+			// a trailing delimiter keeps the stream from reaching EOF, which makes Preview show the ellipsis when the entry has more lines
+			if (head.size() < lines || trailingDelimiter)
+				buffer << File::Preview::LINE_DELIMITER;
+			return{ std::move(buffer), maxLength, maxLines, useEllipsis };
+		}
+
+		/// @brief	Gets the 64-bit FNV-1a hash of the given data, continuing from the given hash.  Used to detect records that weren't written completely.
+		static uint64_t checksum(std::string_view const& data, uint64_t hash = 0xcbf29ce484222325ull)
+		{
+			for (const auto& c : data)
+				hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+			return hash;
+		}
+
+		/**
+		 * @brief		Parses the header line of a record.  The record is only valid once verify() succeeds for its body.
+		 * @param line	The header line, without its line delimiter.
+		 * @param rec	Receives the fields from the header.
+		 * @returns		The size of the body that follows the header, or std::nullopt when line isn't a header.
+		 */
+		static std::optional<size_t> parseHeader(std::string const& line, PreviewRecord& rec)
+		{
+			if (line.size() <= CHECKSUM_WIDTH + 2ull || line.front() != HEADER_PREFIX || line[CHECKSUM_WIDTH + 1ull] != ' ')
+				return std::nullopt;
+			size_t bodySize{ 0ull };
+			if (std::stringstream ss{ line.substr(CHECKSUM_WIDTH + 2ull) }; !(ss >> rec.name >> rec.bytes >> rec.lines >> rec.widest >> rec.trailingDelimiter >> bodySize) || bodySize > MAX_BODY_SIZE)
+				return std::nullopt;
+			return bodySize;
+		}
+		/// @brief	Checks if the given body is the one that the checksum in the given header line was written for.
+		static bool verify(std::string_view const& line, std::string_view const& body)
+		{
+			uint64_t expected{ 0ull };
+			for (const auto& c : line.substr(1ull, CHECKSUM_WIDTH)) {
+				if (c >= '0' && c <= '9') expected = (expected << 4) | static_cast<uint64_t>(c - '0');
+				else if (c >= 'a' && c <= 'f') expected = (expected << 4) | static_cast<uint64_t>(c - 'a' + 10);
+				else return false;
+			}
+			return checksum(body, checksum("\n", checksum(line.substr(CHECKSUM_WIDTH + 2ull)))) == expected;
+		}
+		/// @brief	Sets the head of this record from the body of a verified record.
+		void setHead(std::string_view body)
+		{
+			head.clear();
+			for (size_t pos; (pos = body.find('\n')) != std::string_view::npos; body.remove_prefix(pos + 1ull))
+				head.emplace_back(body.substr(0ull, pos));
+		}
+
+		/// @brief	Writes the record as a header line followed by a body containing each line of the head.  The header holds a checksum of the rest of the record.
+		friend std::ostream& operator<<(std::ostream& os, PreviewRecord const& rec)
+		{
+			std::string body;
+			for (const auto& line : rec.head)
+				(body += line) += '\n';
+			std::stringstream fields;
+			fields << rec.name << ' ' << rec.bytes << ' ' << rec.lines << ' ' << rec.widest << ' ' << rec.trailingDelimiter << ' ' << body.size();
+
+			static constexpr char HEX[]{ "0123456789abcdef" };
+			std::string header(CHECKSUM_WIDTH + 2ull, ' ');
+			header.front() = HEADER_PREFIX;
+			const auto& hash{ checksum(body, checksum("\n", checksum(fields.str()))) };
+			for (size_t i{ 0ull }; i < CHECKSUM_WIDTH; ++i)
+				header[CHECKSUM_WIDTH - i] = HEX[(hash >> (i * 4ull)) & 0xF];
+			return os << header << fields.str() << '\n' << body;
+		}
+	};
+
+	/**
+	 * @class	PreviewIndex
+	 * @brief	Append-only file of preview records stored alongside the history entries.
+	 *			Records are only kept in memory for the entries that were requested when loading.
+	 */
+	class PreviewIndex {
+		std::filesystem::path _path;
+		std::unordered_map<std::string, PreviewRecord> _records;
+		size_t _total{ 0ull };
+		bool _corrupt{ false };
+
+	public:
+		/// @brief	The name of the preview index file, relative to the history directory.
+		static constexpr char FILE_NAME[]{ ".previews" };
+
+		PreviewIndex(std::filesystem::path const& path) : _path{ path } {}
+
+		/// @brief	Gets the (unloaded) preview index belonging to the given history directory.
+		static PreviewIndex of(std::filesystem::path const& history_directory)
+		{
+			return{ history_directory / FILE_NAME };
+		}
+
+		/**
+		 * @brief		Loads the records of the given entries with one sequential read.  The heads of all other records are only verified.
+		 *				Anything that isn't a complete record, such as the remains of an interrupted append, is skipped.
+		 * @param names	The filenames of the entries to load records for.
+		 */
+		PreviewIndex& load(std::unordered_set<std::string> const& names)
+		{
+			_records.clear();
+			_total = 0ull;
+			_corrupt = false;
+			if (std::ifstream ifs{ _path, std::ios_base::in | std::ios_base::binary }; ifs.is_open()) {
+				PreviewRecord rec;
+				std::string body;
+				bool skipped{ false };
+				std::string line;
+				for (std::streampos start{ ifs.tellg() }; std::getline(ifs, line); start = ifs.tellg()) {
+					const auto& pos{ ifs.tellg() };
+					if (const auto& bodySize{ PreviewRecord::parseHeader(line, rec) }; bodySize.has_value()) {
+						body.resize(bodySize.value());
+						if (ifs.read(body.data(), static_cast<std::streamsize>(body.size())) && PreviewRecord::verify(line, body)) {
+							++_total;
+							// an incomplete record at the end may still be being written, but one followed by more records never will be
+							if (skipped)
+								_corrupt = true;
+							skipped = false;
+							if (names.contains(rec.name)) {
+								rec.setHead(body);
+								// later records replace earlier ones for the same entry
+								_records.insert_or_assign(rec.name, std::move(rec));
+								rec = {};
+							}
+							continue;
+						}
+					}
+					// not a complete record, so look for the next header.  An incomplete record may be followed directly by the next one, without a line delimiter.
+					ifs.clear();
+					if (const auto& next{ line.find(PreviewRecord::HEADER_PREFIX, 1ull) }; next != std::string::npos)
+						ifs.seekg(start + static_cast<std::streamoff>(next));
+					else ifs.seekg(pos);
+					skipped = true;
+				}
+			}
+			return *this;
+		}
+
+		/// @brief	Gets the number of records that were in the index file during the last load, including stale ones.
+		size_t total() const { return _total; }
+		/// @brief	Checks if the index file contained damaged records during the last load, meaning that it should be compacted.
+		bool corrupt() const { return _corrupt; }
+
+		/// @brief	Appends the given record to the index file.
+		bool append(PreviewRecord const& rec) const
+		{
+			// write the record with a single call, so that concurrent appends are less likely to interleave
+			std::stringstream ss;
+			ss << rec;
+			const auto& data{ ss.str() };
+			if (std::ofstream ofs{ _path, std::ios_base::out | std::ios_base::app | std::ios_base::binary }; ofs.is_open())
+				return static_cast<bool>(ofs.write(data.data(), static_cast<std::streamsize>(data.size())));
+			return false;
+		}
+
+		/**
+		 * @brief		Rewrites the index file so that it only contains the latest record of each of the given entries.
+		 *				Records appended by other processes during compaction may be lost; those entries fall back to reading the entry.
+		 * @param names	The filenames of all remaining entries.
+		 */
+		bool compact(std::unordered_set<std::string> const& names)
+		{
+			load(names);
+			static std::mt19937_64 rng{ std::random_device{}() };
+			auto tmp{ _path };
+			tmp += '.' + std::to_string(rng()) + ".tmp";
+			if (std::ofstream ofs{ tmp, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary }; ofs.is_open()) {
+				for (const auto& [_, rec] : _records)
+					ofs << rec;
+				ofs.close();
+				std::error_code ec;
+				if (ofs)
+					std::filesystem::rename(tmp, _path, ec);
+				if (!ofs || ec) {
+					std::filesystem::remove(tmp, ec);
+					return false;
+				}
+				_total = _records.size();
+				_corrupt = false;
+				return true;
+			}
+			return false;
+		}
+
+		/// @brief	Gets the record for the entry with the given filename, if one was loaded.
+		std::optional<PreviewRecord> get(std::string const& name) const
+		{
+			if (const auto& it{ _records.find(name) }; it != _records.end())
+				return it->second;
+			return std::nullopt;
+		}
+
+		/**
+		 * @brief				Gets a preview of the given file, from its record when possible or by reading the file otherwise.
+		 * @param file			The history entry to preview.
+		 * @param maxLength		The maximum width of each line.
+		 * @param maxLines		The maximum number of lines.
+		 * @param useEllipsis	Whether to show an ellipsis when the preview doesn't include the entire entry.
+		 */
+		File::Preview getPreview(File const& file, std::optional<size_t> const& maxLength, std::optional<size_t> const& maxLines, bool const& useEllipsis) const
+		{
+			if (const auto& it{ _records.find(file.name()) }; it != _records.end() && it->second.covers(maxLength, maxLines))
+				return it->second.getPreview(maxLength, maxLines, useEllipsis);
+			return file.getPreview(maxLength, maxLines, useEllipsis);
+		}
+	};
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace quip {
+	/**
+	 * @class	SHA256
+	 * @brief	Minimal SHA-256 implementation (FIPS 180-4), used to address chunks by their content.
+	 */
+	class SHA256 {
+	public:
+		using Digest = std::array<unsigned char, 32>;
+
+	private:
+		static constexpr std::array<uint32_t, 64> K{
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+		};
+
+		std::array<uint32_t, 8> _state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+		std::array<unsigned char, 64> _block{};
+		size_t _blockLen{ 0ull };
+		uint64_t _totalLen{ 0ull };
+
+		static constexpr uint32_t rotr(uint32_t const& x, int const& n) { return (x >> n) | (x << (32 - n)); }
+
+		void compress(const unsigned char* p)
+		{
+			std::array<uint32_t, 64> w;
+			for (int i{ 0 }; i < 16; ++i)
+				w[i] = (uint32_t{ p[i * 4] } << 24) | (uint32_t{ p[i * 4 + 1] } << 16) | (uint32_t{ p[i * 4 + 2] } << 8) | uint32_t{ p[i * 4 + 3] };
+			for (int i{ 16 }; i < 64; ++i) {
+				const uint32_t s0{ rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3) };
+				const uint32_t s1{ rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10) };
+				w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+			}
+
+			auto [a, b, c, d, e, f, g, h] { _state };
+			for (int i{ 0 }; i < 64; ++i) {
+				const uint32_t t1{ h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i] };
+				const uint32_t t2{ (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c)) };
+				h = g;
+				g = f;
+				f = e;
+				e = d + t1;
+				d = c;
+				c = b;
+				b = a;
+				a = t1 + t2;
+			}
+			_state[0] += a; _state[1] += b; _state[2] += c; _state[3] += d;
+			_state[4] += e; _state[5] += f; _state[6] += g; _state[7] += h;
+		}
+
+	public:
+		/// @brief	Adds the given data to the hash.
+		SHA256& update(std::string_view data)
+		{
+			_totalLen += data.size();
+			if (_blockLen > 0ull) {
+				const size_t n{ data.size() < 64ull - _blockLen ? data.size() : 64ull - _blockLen };
+				data.copy(reinterpret_cast<char*>(_block.data()) + _blockLen, n);
+				_blockLen += n;
+				data.remove_prefix(n);
+				if (_blockLen < 64ull)
+					return *this;
+				compress(_block.data());
+				_blockLen = 0ull;
+			}
+			for (; data.size() >= 64ull; data.remove_prefix(64ull))
+				compress(reinterpret_cast<const unsigned char*>(data.data()));
+			_blockLen = data.copy(reinterpret_cast<char*>(_block.data()), data.size());
+			return *this;
+		}
+
+		/// @brief	Finishes the hash & returns the digest.  This instance must not be updated afterwards.
+		Digest finish()
+		{
+			const uint64_t bits{ _totalLen * 8ull };
+			_block[_blockLen++] = 0x80;
+			if (_blockLen > 56ull) {
+				std::fill(_block.begin() + _blockLen, _block.end(), 0);
+				compress(_block.data());
+				_blockLen = 0ull;
+			}
+			std::fill(_block.begin() + _blockLen, _block.begin() + 56, 0);
+			for (int i{ 0 }; i < 8; ++i)
+				_block[56 + i] = static_cast<unsigned char>(bits >> (56 - i * 8));
+			compress(_block.data());
+
+			Digest digest;
+			for (int i{ 0 }; i < 8; ++i)
+				for (int j{ 0 }; j < 4; ++j)
+					digest[i * 4 + j] = static_cast<unsigned char>(_state[i] >> (24 - j * 8));
+			return digest;
+		}
+
+		/// @brief	Gets the digest of the given data.
+		static Digest hash(std::string_view data)
+		{
+			return SHA256{}.update(data).finish();
+		}
+	};
+}
@@ -1,13 +1,17 @@
 ﻿#include "rc/version.h"
 #include "Clipboard.h"
 #include "Config.hpp"
+#include "GatherWriter.hpp"
 
 #include <ParamsAPI2.hpp>
 #include <TermAPI.hpp>
 #include <envpath.hpp>
 #include <hasPendingDataSTDIN.h>
 
+#include <cctype>
 #include <iostream>
+#include <unordered_set>
+#include <vector>
 
 inline static constexpr int DEFAULT_LIST_COUNT{ 10 };
 
@@ -24,6 +28,40 @@ template<var::Streamable T> std::ostream& operator<<(std::ostream& os, const std
 	return os;
 }
 
+/**
+ * @brief		Parses a list of cache indexes, such as "0..5,8,10".  Ranges are inclusive.
+ * @param s		The string to parse.
+ * @param size	The number of entries in the history cache.  Any index that is not less than this throws an exception.
+ * @returns		The indexes in the order they were specified.
+ */
+std::vector<size_t> parseIndexList(const std::string& s, const size_t& size)
+{
+	const auto& parseIndex{ [&size](std::string const& n) -> size_t {
+		if (n.empty() || !std::all_of(n.begin(), n.end(), str::stdpred::isdigit))
+			throw make_exception("Invalid Index:  '", n, "' isn't a valid number!");
+		if (const auto& idx{ str::stoull(n) }; idx < size)
+			return idx;
+		else throw make_exception("Index ", idx, " does not exist in the history cache!");
+	} };
+
+	std::vector<size_t> indexes;
+	std::stringstream ss{ s };
+	for (std::string item; std::getline(ss, item, ','); ) {
+		item = str::trim(item);
+		if (const auto& pos{ item.find("..") }; pos != std::string::npos) {
+			const auto& first{ parseIndex(str::trim(item.substr(0ull, pos))) }, last{ parseIndex(str::trim(item.substr(pos + 2ull))) };
+			if (first <= last)
+				for (size_t i{ first }; i <= last; ++i)
+					indexes.emplace_back(i);
+			else
+				for (size_t i{ first }; i + 1ull > last; --i)
+					indexes.emplace_back(i);
+		}
+		else indexes.emplace_back(parseIndex(item));
+	}
+	return indexes;
+}
+
 struct Help {
 	const std::string& programName;
 	const std::string& topic;
@@ -49,11 +87,15 @@ struct Help {
 			<< "  -h, --help               Shows this help display, or detailed help for a specific option ." << '\n'
 			<< "  -v, --version            Prints the current version number, then exits." << '\n'
 			<< "  -q, --quiet              Prevents non-essential console output." << '\n'
+			<< "  -R, --register <NAME>    Uses the named register instead of the clipboard.  Each register has its own history." << '\n'
 			<< "  -O                       Forces a print out of the current clipboard contents, regardless of other options." << '\n'
 			<< "  -s, --set <DATA>         Sets clipboard data to the given string argument.  This is an alternative to shell pipes." << '\n'
 			<< "  -p, --preview <IDX>      Shows a preview of the specified cache entry.  (0 is current, 1 is previous, etc.)" << '\n'
 			<< "  -l, --list [COUNT]       Shows a preview of a number of the most recent clipboard entries.  The default is 10." << '\n'
 			<< "  -d, --dim <<WID>:<LEN>>  Changes the dimensions of the history preview area.  Omit a number to remove that limit." << '\n'
+			<< "      --get <IDX,A..B>     Writes the full contents of several cache entries, separated by the framing option." << '\n'
+			<< "      --framing <nul|len>  Sets the framing used by --get.  'nul' ends each entry with a NUL byte (default)," << '\n'
+			<< "                           while 'len' precedes each entry with its length in bytes and a newline." << '\n'
 			<< "  -r, --recall <IDX>       Recalls the specified cache entry to the clipboard, replacing the current value." << '\n'
 			<< "  -c, --cache              Copy the current clipboard contents to the cache." << '\n'
 			<< "      --clear-cache        Deletes the entire clipboard history cache." << '\n'
@@ -119,6 +161,42 @@ struct Help {
 				<< "  To show the 5 most recent cache entries without truncating them:" << '\n'
 				<< "    " << h.programName << " -dl=5" << '\n'
 				;
+			else if (str::equalsAny(topic, "get", "framing"))
+				os
+				<< QUIP_HELP_HEADER
+				<< "USAGE:\n"
+				<< "  " << h.programName << " --get <INDEXES> [--framing <nul|len>]" << '\n'
+				<< '\n'
+				<< "  Writes the full contents of each of the specified cache entries to STDOUT, in the order they were specified." << '\n'
+				<< "  Indexes are separated by commas, and may include inclusive ranges such as '0..50'." << '\n'
+				<< '\n'
+				<< "  The output is intended for scripts, so entries are framed instead of formatted:" << '\n'
+				<< "    nul    Each entry is followed by a NUL byte.  (default)" << '\n'
+				<< "    len    Each entry is preceded by its length in bytes as a decimal number, followed by a newline." << '\n'
+				<< '\n'
+				<< "EXAMPLES:\n"
+				<< "  Read the 50 most recent entries into a bash array:" << '\n'
+				<< "    mapfile -d '' entries < <(" << h.programName << " --get 0..49)" << '\n'
+				;
+			else if (str::equalsAny(topic, "R", "register"))
+				os
+				<< QUIP_HELP_HEADER
+				<< "USAGE:\n"
+				<< "  " << h.programName << " -R|--register <NAME> [OPTIONS]" << '\n'
+				<< '\n'
+				<< "  Uses the named register instead of the clipboard for all other options." << '\n'
+				<< "  Each register has its own history, stored in the 'registers/<NAME>' directory next to the executable," << '\n'
+				<< "  which is only loaded when that register is used.  Registers never modify the system clipboard." << '\n'
+				<< "  Register names may only contain letters, digits, '-', and '_'." << '\n'
+				<< '\n'
+				<< "  The maximum number of entries kept in a history can be set with 'iMaxEntries' in the [cache] section" << '\n'
+				<< "  of the config, and overridden for a specific register in a [register.<NAME>] section.  0 is unlimited." << '\n'
+				<< '\n'
+				<< "EXAMPLES:\n"
+				<< "  Set the 'build' register, then print it:" << '\n'
+				<< "    " << h.programName << " -R build -s='Hello World!'" << '\n'
+				<< "    " << h.programName << " -R build" << '\n'
+				;
 			else if (str::equalsAny(topic, "r", "recall"))
 				os
 				<< QUIP_HELP_HEADER
@@ -143,7 +221,7 @@ int main(const int argc, char** argv)
 		std::ios_base::sync_with_stdio(false); //< disable cin <=> STDIO synchronization (disables buffering for cin)
 
 		using namespace opt_literals;
-		opt::ParamsAPI2 args{ argc, argv, 's'_req, "set"_req, 'p'_req, "preview"_req, 'l'_opt, "list"_opt, 'd'_req, "dim"_req, 'r'_req, "recall"_req };
+		opt::ParamsAPI2 args{ argc, argv, 's'_req, "set"_req, 'p'_req, "preview"_req, 'l'_opt, "list"_opt, 'd'_req, "dim"_req, 'r'_req, "recall"_req, 'R'_req, "register"_req, "get"_req, "framing"_req };
 		const auto& [programPath, programName] { env::PATH().resolve_split(argv[0]) };
 
 		const auto& configPath{ programPath / (std::filesystem::path{ programName }.replace_extension().generic_string() + ".ini") };
@@ -152,6 +230,8 @@ int main(const int argc, char** argv)
 			{ "cache", {
 				{ "bEnableHistory", "true" },
 			{ "bAutoCache", "false" },
+			{ "bChunkLargeEntries", "false" },
+			{ "iMaxEntries", "0" },
 		} },
 		};
 
@@ -168,6 +248,7 @@ int main(const int argc, char** argv)
 
 		const bool enableHistory{ config.checkv_any("cache", "bEnableHistory", [](std::string const& value) { return str::tolower(str::trim(value)) == "true"; }) };
 		const bool autoCache{ config.checkv_any("cache", "bAutoCache", [](std::string const& value) { return str::tolower(str::trim(value)) == "true"; }) };
+		const bool chunkLargeEntries{ config.checkv_any("cache", "bChunkLargeEntries", [](std::string const& value) { return str::tolower(str::trim(value)) == "true"; }) };
 
 		Config.quiet = args.check_any<opt::Flag, opt::Option>('q', "quiet");
 
@@ -184,7 +265,26 @@ int main(const int argc, char** argv)
 
 		// begin
 
-		quip::Clipboard clipboard(programPath / "history", enableHistory);
+		// select the named register, if one was specified; registers always use their history.
+		const auto& registerName{ args.typegetv_any<opt::Flag, opt::Option>('R', "register").value_or("") };
+		if (!registerName.empty() && !std::all_of(registerName.begin(), registerName.end(), [](char const& c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_'; }))
+			throw make_exception("Invalid Register Name:  '", registerName, "' may only contain letters, digits, '-', and '_'!");
+
+		// get the maximum number of history entries, which each register can override
+		const auto& parseMaxEntries{ [&config](std::string const& section, size_t& maxEntries) {
+			return config.checkv_any(section, "iMaxEntries", [&maxEntries](std::string const& value) {
+				const auto& s{ str::trim(value) };
+				if (s.empty() || !std::all_of(s.begin(), s.end(), str::stdpred::isdigit))
+					return false;
+				maxEntries = str::stoull(s);
+				return true;
+			});
+		} };
+		size_t maxEntries{ 0ull };
+		if (registerName.empty() || !parseMaxEntries("register." + registerName, maxEntries))
+			parseMaxEntries("cache", maxEntries);
+
+		quip::Clipboard clipboard(registerName.empty() ? programPath / "history" : programPath / "registers" / registerName, enableHistory || !registerName.empty(), true, chunkLargeEntries, registerName.empty());
 
 		bool do_io_step{ true }; //< whether or not to perform the I/O step. (although it only affects output, input is always handled when given)
 
@@ -226,6 +326,10 @@ int main(const int argc, char** argv)
 				else throw make_exception("Invalid List Count:  '", s, "' isn't a valid number!");
 			}
 
+			std::unordered_set<std::string> names;
+			for (auto it{ clipboard.history.begin() }; it != clipboard.history.end() && names.size() < static_cast<size_t>(count); ++it)
+				names.emplace(it->name());
+			const auto& previews{ clipboard.history.previews(names) };
 			int i{ 0 };
 			bool fst{ true };
 			for (const auto& it : clipboard.history) {
@@ -237,7 +341,7 @@ int main(const int argc, char** argv)
 
 				if (!Config.quiet) std::cout << '[' << i << "]:\n";
 
-				std::cout << it.getPreview(Config.preview_width, Config.preview_lines, !Config.quiet);
+				std::cout << previews.getPreview(it, Config.preview_width, Config.preview_lines, !Config.quiet);
 
 				if (++i >= count)
 					break;
@@ -249,9 +353,33 @@ int main(const int argc, char** argv)
 			const auto& idx{ previewArg.value() };
 
 			if (const auto& entry{ clipboard.history.get(idx) }; entry.has_value())
-				std::cout << entry.value().getPreview(Config.preview_width, Config.preview_lines, !Config.quiet);
+				std::cout << clipboard.history.previews({ entry.value().name() }).getPreview(entry.value(), Config.preview_width, Config.preview_lines, !Config.quiet);
 			else throw make_exception("Index ", idx, " does not exist in the history cache!");
 		}
+		// Write several cache entries with machine-readable framing
+		if (const auto& getArg{ args.typegetv_any<opt::Option>("get") }; getArg.has_value()) {
+			do_io_step = false;
+
+			const auto& framing{ str::tolower(str::trim(args.typegetv_any<opt::Option>("framing").value_or("nul"))) };
+			const bool useLength{ str::equalsAny(framing, "len", "length") };
+			if (!useLength && !str::equalsAny(framing, "nul", "null"))
+				throw make_exception("Invalid Framing:  '", framing, "' isn't a valid framing type!  Expected 'nul' or 'len'.");
+
+			// validate all indexes before writing anything, so the output is never partial
+			const auto& indexes{ parseIndexList(getArg.value(), clipboard.history.size()) };
+
+			std::cout.flush();
+			quip::GatherWriter writer;
+			for (const auto& idx : indexes) {
+				auto data{ clipboard.history.get(idx).value().str() };
+				if (useLength)
+					writer.push(std::to_string(data.size()) + '\n');
+				writer.push(std::move(data));
+				if (!useLength)
+					writer.push(std::string(1ull, '\0'));
+			}
+			writer.flush();
+		}
 		// recall cache entry to clipboard
 		if (const auto& index{ args.castgetv_any<size_t, opt::Flag, opt::Option>(str::stoull, 'r', "recall") }; index.has_value()) {
 			do_io_step = false;
@@ -308,6 +436,10 @@ int main(const int argc, char** argv)
 		if ((do_io_step && (setArgs.empty() && !hasPendingData)) || args.checkflag('O'))
 			std::cout << clipboard;
 
+		// apply retention limits
+		if (clipboard.useHistory && maxEntries > 0ull)
+			clipboard.history.delete_all_but(maxEntries);
+
 		return 0;
 	} catch (const std::exception& ex) {
 		std::cerr << term::get_fatal() << ex.what() << std::endl;